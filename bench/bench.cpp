@@ -0,0 +1,301 @@
+// Host microbenchmarks for the firmware's hot functions.
+//
+// main.cpp is compiled as-is against the stub libraries in bench/hal, so the
+// numbers cover the firmware's own code (string building, formatting, math)
+// but not the time the Proteus spends talking to the hardware.
+//
+// usage: bench [--baseline FILE]... [--write-baseline FILE] [--write-allocations FILE] [--tolerance FRACTION]
+// with --baseline, exits with status 1 if any benchmark got slower than the
+// baseline by more than the tolerance or allocates more per call. a baseline
+// written with --write-allocations only has allocations/call, which don't
+// depend on the machine, so only those are compared.
+
+#define main firmware_main
+#include "../main.cpp"
+#undef main
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// the CPU's fixed rate tick counter, if there's one we know how to read. it counts at
+// a constant rate (the TSC on x86, the generic timer on arm64), not the core's clock
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TICKS 1
+#elif defined(__aarch64__)
+#define HAVE_TICKS 1
+#endif
+
+// every allocation made by the program goes through these, so a benchmark's
+// allocations per call is the change in `allocations` divided by the calls
+static unsigned long allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// stop the compiler from optimizing away a result
+template <typename T>
+static inline void keep(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static inline unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    unsigned long long value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return 0;
+#endif
+}
+
+struct Result {
+    const char *name;
+    double nsPerCall;
+    // -1 without a tick counter
+    double ticksPerCall;
+    double allocsPerCall;
+};
+
+// how many calls to time in each repetition
+const int CALLS = 200000;
+
+// the fastest of this many repetitions is reported
+const int REPETITIONS = 7;
+
+// time `f` and count its allocations
+template <typename F>
+static Result measure(const char *name, F f) {
+    for (int i = 0; i < CALLS / 10; i++) {
+        f(i);
+    }
+    Result result = {name, 1e30, -1, 0};
+    for (int r = 0; r < REPETITIONS; r++) {
+        unsigned long startAllocations = allocations;
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long startTicks = ticks();
+        for (int i = 0; i < CALLS; i++) {
+            f(i);
+        }
+        unsigned long long endTicks = ticks();
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / CALLS;
+        if (ns < result.nsPerCall) {
+            result.nsPerCall = ns;
+#ifdef HAVE_TICKS
+            result.ticksPerCall = (double)(endTicks - startTicks) / CALLS;
+#endif
+        }
+        result.allocsPerCall = (double)(allocations - startAllocations) / CALLS;
+    }
+    return result;
+}
+
+static std::vector<Result> run_benchmarks() {
+    log_file = SD.FOpen("log.csv", "w");
+    LCD.Clear();
+    RPS.x = 12.5f;
+    RPS.y = 45.25f;
+    RPS.heading = 91.0f;
+    RPS.lever = 1;
+    cdsCell.value = 2.1f;
+
+    static const double headings[] = {0.0, 359.5, 90.25, 181.0, 270.0, 3.75, 179.0, 268.5};
+    volatile double targetHeading = HEADING_LEFT;
+
+    std::vector<Result> results;
+    results.push_back(measure("update", [](int) {
+        nextUpdateGuiTime = 1e30;
+        keep(update());
+    }));
+    results.push_back(measure("update_gui_log", [](int) {
+        nextUpdateGuiTime = 0;
+        keep(update());
+    }));
+    results.push_back(measure("textLine", [](int) {
+        textLine("move forward", 0);
+    }));
+    results.push_back(measure("textLine_value", [](int i) {
+        textLine("counts", (double)i, 1);
+    }));
+    results.push_back(measure("getCounts", [](int i) {
+        right_encoder.counts = i;
+        keep(getCounts().value);
+    }));
+    results.push_back(measure("heading_difference", [&](int i) {
+        keep(heading_difference(headings[i & 7], targetHeading));
+    }));
+    results.push_back(measure("log_sample", [](int) {
+        log_sample();
+    }));
+    return results;
+}
+
+struct Baseline {
+    std::string name;
+    // -1 if the baseline only has allocations
+    double nsPerCall;
+    double allocsPerCall;
+};
+
+// add the entries in the baseline file `path` to `baseline`
+static void read_baseline(const char *path, std::vector<Baseline> &baseline) {
+    FILE *file = std::fopen(path, "r");
+    if (!file) {
+        std::fprintf(stderr, "bench: can't open baseline %s\n", path);
+        std::exit(2);
+    }
+    char line[256];
+    while (std::fgets(line, sizeof(line), file)) {
+        char name[128];
+        double first, second;
+        if (line[0] == '#') {
+            continue;
+        }
+        int fields = std::sscanf(line, "%127s %lf %lf", name, &first, &second);
+        if (fields == 3) {
+            baseline.push_back({name, first, second});
+        } else if (fields == 2) {
+            baseline.push_back({name, -1, first});
+        }
+    }
+    std::fclose(file);
+}
+
+static void write_baseline(const char *path, const std::vector<Result> &results) {
+    FILE *file = std::fopen(path, "w");
+    if (!file) {
+        std::fprintf(stderr, "bench: can't write baseline %s\n", path);
+        std::exit(2);
+    }
+    std::fprintf(file, "# name ns/call allocs/call\n");
+    for (const Result &r : results) {
+        std::fprintf(file, "%s %.2f %.2f\n", r.name, r.nsPerCall, r.allocsPerCall);
+    }
+    std::fclose(file);
+}
+
+static void write_allocations(const char *path, const std::vector<Result> &results) {
+    FILE *file = std::fopen(path, "w");
+    if (!file) {
+        std::fprintf(stderr, "bench: can't write allocations %s\n", path);
+        std::exit(2);
+    }
+    std::fprintf(file, "# name allocs/call\n");
+    for (const Result &r : results) {
+        std::fprintf(file, "%s %.2f\n", r.name, r.allocsPerCall);
+    }
+    std::fclose(file);
+}
+
+int main(int argc, char **argv) {
+    std::vector<const char *> baselinePaths;
+    const char *writePath = nullptr;
+    const char *writeAllocationsPath = nullptr;
+    // how much slower than the baseline a benchmark may get, as a fraction
+    double tolerance = 0.5;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baselinePaths.push_back(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--write-baseline") && i + 1 < argc) {
+            writePath = argv[++i];
+        } else if (!std::strcmp(argv[i], "--write-allocations") && i + 1 < argc) {
+            writeAllocationsPath = argv[++i];
+        } else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--baseline FILE]... [--write-baseline FILE] [--write-allocations FILE] [--tolerance FRACTION]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<Result> results = run_benchmarks();
+    std::vector<Baseline> baseline;
+    for (const char *path : baselinePaths) {
+        read_baseline(path, baseline);
+    }
+
+    bool regressed = false;
+    std::printf("%-20s %12s %12s %12s %12s\n", "benchmark", "ns/call", "ticks/call", "allocs/call", "baseline ns");
+    for (const Result &r : results) {
+        // the timing baseline, if there is one
+        double baseNs = -1;
+        bool found = false;
+        const char *status = "";
+        for (const Baseline &b : baseline) {
+            if (b.name != r.name) {
+                continue;
+            }
+            found = true;
+            // allow a couple of nanoseconds of noise on the very fast benchmarks
+            if (b.nsPerCall >= 0) {
+                baseNs = b.nsPerCall;
+                if (r.nsPerCall > b.nsPerCall * (1 + tolerance) + 2.0) {
+                    status = "  SLOWER";
+                    regressed = true;
+                }
+            }
+            if (r.allocsPerCall > b.allocsPerCall + 0.01) {
+                status = "  MORE ALLOCATIONS";
+                regressed = true;
+            }
+        }
+        if (!found && !baselinePaths.empty()) {
+            status = "  (not in baseline)";
+        }
+        char baseText[32] = "-";
+        if (baseNs >= 0) {
+            std::snprintf(baseText, sizeof(baseText), "%.2f", baseNs);
+        }
+        char ticksText[32] = "-";
+        if (r.ticksPerCall >= 0) {
+            std::snprintf(ticksText, sizeof(ticksText), "%.1f", r.ticksPerCall);
+        }
+        std::printf("%-20s %12.2f %12s %12.2f %12s%s\n", r.name, r.nsPerCall, ticksText, r.allocsPerCall,
+                    baseText, status);
+    }
+
+    if (writePath) {
+        write_baseline(writePath, results);
+        std::printf("wrote baseline to %s\n", writePath);
+    }
+    if (writeAllocationsPath) {
+        write_allocations(writeAllocationsPath, results);
+        std::printf("wrote allocations to %s\n", writeAllocationsPath);
+    }
+    if (regressed) {
+        std::printf("performance regression against the baseline\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+// Host stub of the Proteus FEHBattery library, used only by the benchmark build.
+#ifndef FEHBATTERY_H
+#define FEHBATTERY_H
+
+#include "FEHIO.h"
+
+class FEHBattery {
+public:
+    explicit FEHBattery(FEHIO::FEHIOPin pin);
+    float Voltage();
+
+    // value returned by Voltage(), set by the benchmark
+    float voltage;
+};
+
+extern FEHBattery Battery;
+
+#endif
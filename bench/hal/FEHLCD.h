@@ -0,0 +1,41 @@
+// Host stub of the Proteus FEHLCD library, used only by the benchmark build.
+// Text is rendered into an in-memory character grid instead of the screen.
+#ifndef FEHLCD_H
+#define FEHLCD_H
+
+#define BLACK 0x000000u
+#define WHITE 0xFFFFFFu
+#define RED 0xFF0000u
+#define GREEN 0x00FF00u
+#define BLUE 0x0000FFu
+
+class FEHLCD {
+public:
+    static const int ROWS = 14;
+    static const int COLS = 26;
+
+    void Clear();
+    void Clear(unsigned int color);
+    void SetFontColor(unsigned int color);
+    void SetBackgroundColor(unsigned int color);
+
+    void Write(const char *str);
+    void Write(int i);
+    void Write(float f);
+    void Write(double d);
+    void WriteLine(const char *str);
+    void WriteLine(int i);
+    void WriteLine(float f);
+    void WriteLine(double d);
+    void WriteRC(const char *str, int row, int col);
+
+    bool Touch(float *x_pos, float *y_pos);
+
+    char grid[ROWS][COLS];
+    unsigned int backgroundColor;
+    unsigned int fontColor;
+};
+
+extern FEHLCD LCD;
+
+#endif
@@ -0,0 +1,17 @@
+// Host stub of the Proteus FEHMotor library, used only by the benchmark build.
+#ifndef FEHMOTOR_H
+#define FEHMOTOR_H
+
+class FEHMotor {
+public:
+    typedef enum { Motor0 = 0, Motor1, Motor2, Motor3 } FEHMotorPort;
+
+    FEHMotor(FEHMotorPort port, float max_voltage);
+    void SetPercent(float percent);
+    void Stop();
+
+    // last value passed to SetPercent()
+    float percent;
+};
+
+#endif
@@ -0,0 +1,24 @@
+// Host stub of the Proteus FEHRPS library, used only by the benchmark build.
+#ifndef FEHRPS_H
+#define FEHRPS_H
+
+class FEHRPS {
+public:
+    void InitializeTouchMenu();
+    int GetCorrectLever();
+    float X();
+    float Y();
+    float Heading();
+    char CurrentRegionLetter();
+
+    // values returned by the accessors above, set by the benchmark
+    float x;
+    float y;
+    float heading;
+    int lever;
+    char region;
+};
+
+extern FEHRPS RPS;
+
+#endif
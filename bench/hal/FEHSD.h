@@ -0,0 +1,24 @@
+// Host stub of the Proteus FEHSD library, used only by the benchmark build.
+// Formatted output goes into a fixed in-memory buffer so that logging costs
+// the same formatting work as on the robot without touching the host disk.
+#ifndef FEHSD_H
+#define FEHSD_H
+
+struct FEHFile {
+    char buffer[4096];
+    int length;
+    bool open;
+};
+
+class FEHSD {
+public:
+    FEHFile *FOpen(const char *path, const char *mode);
+    int FClose(FEHFile *file);
+    int FPrintf(FEHFile *file, const char *format, ...);
+    int FScanf(FEHFile *file, const char *format, ...);
+    int FEof(FEHFile *file);
+};
+
+extern FEHSD SD;
+
+#endif
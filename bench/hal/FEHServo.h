@@ -0,0 +1,21 @@
+// Host stub of the Proteus FEHServo library, used only by the benchmark build.
+#ifndef FEHSERVO_H
+#define FEHSERVO_H
+
+class FEHServo {
+public:
+    typedef enum {
+        Servo0 = 0, Servo1, Servo2, Servo3, Servo4, Servo5, Servo6, Servo7
+    } FEHServoPort;
+
+    explicit FEHServo(FEHServoPort port);
+    void SetMin(int min);
+    void SetMax(int max);
+    void SetDegree(float degree);
+    void Off();
+
+    // last value passed to SetDegree()
+    float degree;
+};
+
+#endif
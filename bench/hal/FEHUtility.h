@@ -0,0 +1,14 @@
+// Host stub of the Proteus FEHUtility library, used only by the benchmark build.
+#ifndef FEHUTILITY_H
+#define FEHUTILITY_H
+
+// seconds since the program started, read from the host's monotonic clock
+double TimeNow();
+unsigned int TimeNowSec();
+unsigned long TimeNowMSec();
+
+void Sleep(int msec);
+void Sleep(float sec);
+void Sleep(double sec);
+
+#endif
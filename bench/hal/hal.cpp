@@ -0,0 +1,229 @@
+// Host implementations of the stub Proteus libraries in this directory.
+// Every call does roughly the work the real library does in software
+// (formatting, copying into buffers) but none of the hardware I/O.
+#include "FEHBattery.h"
+#include "FEHIO.h"
+#include "FEHLCD.h"
+#include "FEHMotor.h"
+#include "FEHRPS.h"
+#include "FEHSD.h"
+#include "FEHServo.h"
+#include "FEHUtility.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+FEHBattery Battery(FEHIO::BATTERY_VOLTAGE);
+FEHLCD LCD;
+FEHRPS RPS;
+FEHSD SD;
+
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+double TimeNow() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+unsigned int TimeNowSec() {
+    return (unsigned int)TimeNow();
+}
+
+unsigned long TimeNowMSec() {
+    return (unsigned long)(TimeNow() * 1000);
+}
+
+void Sleep(double sec) {
+    double end = TimeNow() + sec;
+    while (TimeNow() < end);
+}
+
+void Sleep(float sec) {
+    Sleep((double)sec);
+}
+
+void Sleep(int msec) {
+    Sleep(msec / 1000.0);
+}
+
+DigitalEncoder::DigitalEncoder(FEHIO::FEHIOPin) : counts(0) {}
+
+int DigitalEncoder::Counts() {
+    return counts;
+}
+
+void DigitalEncoder::ResetCounts() {
+    counts = 0;
+}
+
+AnalogInputPin::AnalogInputPin(FEHIO::FEHIOPin) : value(3.3f) {}
+
+float AnalogInputPin::Value() {
+    return value;
+}
+
+FEHBattery::FEHBattery(FEHIO::FEHIOPin) : voltage(11.5f) {}
+
+float FEHBattery::Voltage() {
+    return voltage;
+}
+
+FEHMotor::FEHMotor(FEHMotorPort, float) : percent(0) {}
+
+void FEHMotor::SetPercent(float p) {
+    percent = p;
+}
+
+void FEHMotor::Stop() {
+    percent = 0;
+}
+
+FEHServo::FEHServo(FEHServoPort) : degree(0) {}
+
+void FEHServo::SetMin(int) {}
+
+void FEHServo::SetMax(int) {}
+
+void FEHServo::SetDegree(float d) {
+    degree = d;
+}
+
+void FEHServo::Off() {}
+
+void FEHLCD::Clear() {
+    std::memset(grid, ' ', sizeof(grid));
+}
+
+void FEHLCD::Clear(unsigned int color) {
+    backgroundColor = color;
+    Clear();
+}
+
+void FEHLCD::SetFontColor(unsigned int color) {
+    fontColor = color;
+}
+
+void FEHLCD::SetBackgroundColor(unsigned int color) {
+    backgroundColor = color;
+}
+
+void FEHLCD::WriteRC(const char *str, int row, int col) {
+    if (row < 0 || row >= ROWS) {
+        return;
+    }
+    for (; col < COLS && *str; col++, str++) {
+        if (col >= 0) {
+            grid[row][col] = *str;
+        }
+    }
+}
+
+void FEHLCD::Write(const char *str) {
+    WriteRC(str, 0, 0);
+}
+
+void FEHLCD::Write(int i) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%d", i);
+    Write(buffer);
+}
+
+void FEHLCD::Write(float f) {
+    Write((double)f);
+}
+
+void FEHLCD::Write(double d) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%f", d);
+    Write(buffer);
+}
+
+void FEHLCD::WriteLine(const char *str) {
+    Write(str);
+}
+
+void FEHLCD::WriteLine(int i) {
+    Write(i);
+}
+
+void FEHLCD::WriteLine(float f) {
+    Write(f);
+}
+
+void FEHLCD::WriteLine(double d) {
+    Write(d);
+}
+
+bool FEHLCD::Touch(float *x_pos, float *y_pos) {
+    *x_pos = 0;
+    *y_pos = 0;
+    return false;
+}
+
+void FEHRPS::InitializeTouchMenu() {}
+
+int FEHRPS::GetCorrectLever() {
+    return lever;
+}
+
+float FEHRPS::X() {
+    return x;
+}
+
+float FEHRPS::Y() {
+    return y;
+}
+
+float FEHRPS::Heading() {
+    return heading;
+}
+
+char FEHRPS::CurrentRegionLetter() {
+    return region;
+}
+
+static FEHFile files[4];
+
+FEHFile *FEHSD::FOpen(const char *, const char *mode) {
+    // nothing is ever persisted on the host, so there is nothing to read back
+    if (mode[0] == 'r') {
+        return nullptr;
+    }
+    for (FEHFile &file : files) {
+        if (!file.open) {
+            file.open = true;
+            file.length = 0;
+            return &file;
+        }
+    }
+    return nullptr;
+}
+
+int FEHSD::FClose(FEHFile *file) {
+    file->open = false;
+    return 0;
+}
+
+int FEHSD::FPrintf(FEHFile *file, const char *format, ...) {
+    // wrap around instead of growing so logging never allocates
+    if (file->length > (int)sizeof(file->buffer) / 2) {
+        file->length = 0;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = std::vsnprintf(file->buffer + file->length, sizeof(file->buffer) - file->length, format, args);
+    va_end(args);
+    if (n > 0) {
+        file->length += n;
+    }
+    return n;
+}
+
+int FEHSD::FScanf(FEHFile *, const char *, ...) {
+    return EOF;
+}
+
+int FEHSD::FEof(FEHFile *) {
+    return 1;
+}
@@ -0,0 +1,53 @@
+// Code units.h should refuse to compile. `make units-check` builds this once with
+// CASE=0, which has to compile, and once per other CASE, each of which has to fail.
+#include "../units.h"
+
+static void drive_to(Percent, Inches) {}
+static void drive_to(Percent, Counts) {}
+static void spin(Percent, Degrees) {}
+static void spin(Percent, Counts) {}
+
+int main() {
+    drive_to(80_pct, 18_in - 4_in);
+    spin(80.0_pct, 90_deg * 1.65);
+    constexpr Counts up_ramp = route_counts(6_in + 12.31_in - 4_in);
+    constexpr Counts ramp_turn = route_counts(90_deg * 1.65);
+    drive_to(80_pct, up_ramp);
+    spin(80_pct, ramp_turn);
+#if CASE == 1
+    // out of range percent passed straight to a function
+    drive_to(150_pct, 5_in);
+#elif CASE == 2
+    // too short for the encoders to count
+    drive_to(50_pct, 0.001_in);
+#elif CASE == 3
+    // too small a turn for the encoders to count
+    spin(50_pct, 0.01_deg);
+#elif CASE == 4
+    // a turn where a distance is expected
+    drive_to(50_pct, 90_deg);
+#elif CASE == 5
+    // only plain decimals
+    drive_to(50_pct, 1e1_in);
+#elif CASE == 6
+    // a plain number where a distance is expected
+    drive_to(50_pct, 5);
+#elif CASE == 7
+    // out of range constexpr percent
+    constexpr Percent tooFast(101);
+    (void)tooFast;
+#elif CASE == 8
+    // a route distance that adds up to nothing
+    constexpr Counts nowhere = route_counts(5_in + 4.4_in - 9.4_in);
+    drive_to(50_pct, nowhere);
+#elif CASE == 9
+    // a route distance that adds up to less than one count
+    constexpr Counts tooShort = route_counts(1_in - 0.99_in);
+    drive_to(50_pct, tooShort);
+#elif CASE == 10
+    // a route turn that comes out backwards
+    constexpr Counts backwards = route_counts(90_deg * -1.65);
+    spin(50_pct, backwards);
+#endif
+    return 0;
+}
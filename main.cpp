@@ -5,9 +5,11 @@
 #include <FEHMotor.h>
 #include <FEHRPS.h>
 #include <FEHSD.h>
+#include <FEHBattery.h>
 #include <cmath>
 #include <vector>
 #include <string>
+#include "units.h"
 
 
 // size of Proteus screen
@@ -23,6 +25,9 @@ const double TIME_OUT = 10.0;
 // how many times to check_[xy]
 const int CHECK_TIMES = 20;
 
+// how many times check_heading reads the heading before giving up
+const int CHECK_HEADING_TIMES = 100;
+
 // RPS heading values
 const double HEADING_DOWN = 180;
 const double HEADING_RIGHT = 270;
@@ -33,20 +38,8 @@ const double HEADING_LEFT = 90;
 // (if it goes more than this, it pushes up on the chassis and goes back up)
 const double ALL_THE_WAY_DOWN = 122.0;
 
-// radius of wheel, in inches
-constexpr double WHEEL_RADIUS = 2.5 / 2;
-
-// wheel distance, in inches
-constexpr double WHEEL_DISTANCE = 7;
-
-// the ratio of a circles circumphrence to its diameter
-constexpr double PI = 3.14159;
-
-// how many counts in one revoltion of an Igwan motor
-constexpr int ONE_REVOLUTION_COUNTS = 318;
-
 // motor power for check heading without luggage
-double regular_check_heading_power = 25.0;
+constexpr Percent regular_check_heading_power = 25_pct;
 
 // multiply left motor percent by this to callibrate the motors
 double leftMultiplier = 1;
@@ -71,6 +64,108 @@ bool red = false;
 // file for logging to the SD card ("log.csv")
 FEHFile *log_file;
 
+// how many things have gone wrong (RPS failures, checks that gave up, moves that timed out)
+// since the current course task started
+int task_faults = 0;
+
+// file on the SD card with the battery voltage the motor percents, pulse times and turn
+// powers were tuned at. it's recorded from the start menu (see choose_start_task)
+const char *TUNED_VOLTAGE_FILE = "tunevolt.txt";
+
+// the voltage in TUNED_VOLTAGE_FILE, or 0 if it hasn't been recorded
+// the motors are driven harder below it and softer above it so they keep the same speed
+double tunedBatteryVoltage = 0;
+
+// how often update() reads the battery voltage, in seconds
+const double BATTERY_SAMPLE_PERIOD = 0.1;
+
+// how long after the drive motors stop before the battery is read again, in seconds.
+// the voltage sags while they draw current and takes a moment to come back, and the
+// tuned voltage is recorded with them stopped, so only resting readings compare to it
+const double BATTERY_REST_TIME = 0.5;
+
+// how much each reading moves the filtered voltage. small so one noisy
+// reading doesn't make the compensation jump around
+const double BATTERY_FILTER_RATE = 0.05;
+
+// never scale motor percents by more than this (or less than one over it),
+// in case of a bad reading
+const double MAX_BATTERY_COMPENSATION = 1.4;
+
+// filtered battery voltage (main starts it at the voltage when the robot is turned on)
+double batteryVoltage = 0;
+
+// next time update() should read the battery
+double nextBatterySampleTime = 0;
+
+// true while drive() has the drive motors running
+bool driving = false;
+
+// read the battery voltage into the filter
+void sample_battery() {
+    batteryVoltage += BATTERY_FILTER_RATE * (Battery.Voltage() - batteryVoltage);
+}
+
+// how much to multiply motor percents by for the current battery voltage
+// without a tuned voltage to compare to, the percents are left as they are
+double battery_compensation() {
+    if (tunedBatteryVoltage <= 0 || batteryVoltage <= 0) {
+        return 1;
+    }
+    double compensation = tunedBatteryVoltage / batteryVoltage;
+    if (compensation > MAX_BATTERY_COMPENSATION) {
+        return MAX_BATTERY_COMPENSATION;
+    }
+    if (compensation < 1 / MAX_BATTERY_COMPENSATION) {
+        return 1 / MAX_BATTERY_COMPENSATION;
+    }
+    return compensation;
+}
+
+// read the tuned voltage recorded by an earlier run, if there is one
+void load_tuned_voltage() {
+    FEHFile *file = SD.FOpen(TUNED_VOLTAGE_FILE, "r");
+    if (!file) {
+        return;
+    }
+    double voltage;
+    if (SD.FScanf(file, "%lf", &voltage) == 1 && voltage > 0) {
+        tunedBatteryVoltage = voltage;
+    }
+    SD.FClose(file);
+}
+
+// record the filtered battery voltage as the one the robot is tuned at
+// (do this right after tuning, on the battery that was used for it). it's read with the
+// motors stopped, like the readings it's compared to during a run
+void save_tuned_voltage() {
+    FEHFile *file = SD.FOpen(TUNED_VOLTAGE_FILE, "w");
+    if (!file) {
+        return;
+    }
+    SD.FPrintf(file, "%f\n", batteryVoltage);
+    SD.FClose(file);
+    tunedBatteryVoltage = batteryVoltage;
+    SD.FPrintf(log_file, "# tuned battery voltage recorded: %f V\n", tunedBatteryVoltage);
+}
+
+// set the drive motors to the speeds `right` and `left` gave at tunedBatteryVoltage
+// (percents that end up past 100 are clamped by Percent)
+void drive(Percent right, Percent left) {
+    double compensation = battery_compensation();
+    right_motor.SetPercent(Percent(right.value * compensation).value);
+    left_motor.SetPercent(Percent(left.value * compensation).value);
+    driving = true;
+}
+
+// stop both drive motors, and wait for the battery to rest before reading it again
+void stop_driving() {
+    right_motor.Stop();
+    left_motor.Stop();
+    driving = false;
+    nextBatterySampleTime = TimeNow() + BATTERY_REST_TIME;
+}
+
 // write `s` to the screen at row `row`
 void textLine(std::string s, int row) {
     int width = 26;
@@ -92,6 +187,11 @@ std::string colorString = "color: ?";
 // (if you draw to the screen too fast it will be unreadable)
 double nextUpdateGuiTime = 0;
 
+// write the current time, position, heading, and cds cell value to log_file
+void log_sample() {
+    SD.FPrintf(log_file, "%f,%f,%f,%f,%f\n", TimeNow(), RPS.X(), RPS.Y(), RPS.Heading(), cdsCell.Value());
+}
+
 // this should be called as fast as possible in every loop
 // it reads the cds cell, updating the global variable `red`
 // it stores the fuel lever index in the global variable fuel_lever
@@ -99,6 +199,11 @@ double nextUpdateGuiTime = 0;
 // it also updates the gui if enough time has passed
 // returns `true` if it updated the gui
 bool update() {
+    double now = TimeNow();
+    if (!driving && now > nextBatterySampleTime) {
+        sample_battery();
+        nextBatterySampleTime = now + BATTERY_SAMPLE_PERIOD;
+    }
     if (cdsCell.Value() < 1.0) {
         red = true;
     }
@@ -106,8 +211,8 @@ bool update() {
     if (rps_lever >= 0) {
         fuel_lever = rps_lever;
     }
-    if (TimeNow() > nextUpdateGuiTime) {
-        SD.FPrintf(log_file, "%f,%f,%f,%f,%f\n", TimeNow(), RPS.X(), RPS.Y(), RPS.Heading(), cdsCell.Value());
+    if (now > nextUpdateGuiTime) {
+        log_sample();
         // if RPS isn't working put red on the screen
         if (RPS.X() < 0) {
             LCD.SetBackgroundColor(RED);
@@ -120,12 +225,20 @@ bool update() {
         textLine(colorString, 12);
         textLine("cds", cdsCell.Value(), 13);
         // textLine("lever", fuel_lever, 13);
-        nextUpdateGuiTime = TimeNow() + 0.25;
+        nextUpdateGuiTime = now + 0.25;
         return true;
     }
     return false;
 }
 
+// log that something went wrong during the current task
+// if any did, course() checks the pose the next task expects before starting it
+void record_fault(const char *what) {
+    task_faults++;
+    SD.FPrintf(log_file, "# fault: %s\n", what);
+    textLine(what, 5);
+}
+
 // reset counts on both encoders
 void resetCounts() {
     left_encoder.ResetCounts();
@@ -137,7 +250,7 @@ void resetCounts() {
 // otherwise return the one that works
 // bool bothEncodersWork = false;
 
-int getCounts() {
+Counts getCounts() {
     // bool bothEncodersWork = false;
     // if (left_encoder.Counts() > 0 && right_encoder.Counts() > 0) {
     //     bothEncodersWork = true;
@@ -148,10 +261,13 @@ int getCounts() {
     //     textLine("encoder failure", 8);
         // return (left_encoder.Counts() + right_encoder.Counts());
     // }
-    return right_encoder.Counts();
+    return Counts(right_encoder.Counts());
 }
 
 
+// when the run started (the first time wait_for_light returned), or -1 if it hasn't yet
+double courseStartTime = -1;
+
 // wait for the light to turn on
 void wait_for_light() {
     double timeOut = TimeNow() + 30.0;
@@ -161,30 +277,29 @@ void wait_for_light() {
             textLine("timeout", timeOut - TimeNow(), 1);
         }
     }
+    if (courseStartTime < 0) {
+        courseStartTime = TimeNow();
+    }
 }
 
 
-// move forward at motor percent `percent` for `inches` inches using shaft encoding
-void move_forward(int percent, double inches)
+// move forward at motor percent `percent` for `expectedCounts` encoder counts
+void move_forward(Percent percent, Counts expectedCounts)
 {
-    // to move backward, percent should be negative but inches should be positive
-    if (inches < 0) {
-        move_forward(-percent, -inches);
+    // to move backward, percent should be negative but counts should be positive
+    if (expectedCounts < Counts(0)) {
+        move_forward(-percent, Counts(-expectedCounts.value));
         return;
     }
     LCD.Clear();
-    textLine(percent > 0 ? "move forward" : "move backward", 0);
+    textLine(percent > 0_pct ? "move forward" : "move backward", 0);
     // sleep(1.0);
     double startTime = TimeNow();
 
-    // calculate expected motor counts using math
-    int expectedCounts = (ONE_REVOLUTION_COUNTS * inches) / (2 * PI * WHEEL_RADIUS);
-
     resetCounts();
 
     // start motors
-    right_motor.SetPercent(percent);
-    left_motor.SetPercent(leftMultiplier*percent);
+    drive(percent, percent * leftMultiplier);
 
 
     double nextTime = 0;
@@ -194,68 +309,74 @@ void move_forward(int percent, double inches)
         update();
         // stop if timeout occurs
         if (TimeNow() > startTime+TIME_OUT) {
+            record_fault("move timed out");
             break;
         }
-        int counts = getCounts();
+        Counts counts = getCounts();
         if (counts >= expectedCounts) {
             break;
         }
-        textLine("expected counts", expectedCounts, 4);
+        textLine("expected counts", expectedCounts.value, 4);
         if (TimeNow() > nextTime) {
-            textLine("counts", counts, 1);
-            textLine("distance", ((double)counts / expectedCounts) * inches, 2);
+            textLine("counts", counts.value, 1);
+            textLine("distance", to_inches(counts).value, 2);
             textLine("time", TimeNow() - startTime, 3);
             nextTime = TimeNow() + .25;
         }
     }
 
 
-    right_motor.Stop();
-    left_motor.Stop();
+    stop_driving();
 }
 
+// move forward at motor percent `percent` for `inches` inches using shaft encoding
+// (`inches` is converted to counts when this is called. pass a constexpr Counts from
+// route_counts to have that done, and checked, at compile time)
+inline void move_forward(Percent percent, Inches inches) {
+    move_forward(percent, to_counts(inches));
+}
+
+// move backward with motor power `percent` until the encoder reads `expectedCounts` counts
+inline void move_backward(Percent percent, Counts expectedCounts) {
+    move_forward(-percent, expectedCounts);
+}
 
 // move backward with motor power `percent` for `inches` inches using shaft encoding
-void move_backward(int percent, double inches) {
-    move_forward(-percent, inches);
+inline void move_backward(Percent percent, Inches inches) {
+    move_forward(-percent, to_counts(inches));
 }
 
-// turn right `degrees` degrees with motor power `percent` using shaft encoding
-void turn_right(int percent, double degrees)
+// turn right with motor power `percent` until the encoder reads `expectedCounts` counts
+void turn_right(Percent percent, Counts expectedCounts)
 {
-    // to turn left, percent should be negative but degrees positive
-    if (degrees < 0) {
-        turn_right(-percent, -degrees);
+    // to turn left, percent should be negative but counts positive
+    if (expectedCounts < Counts(0)) {
+        turn_right(-percent, Counts(-expectedCounts.value));
         return;
     }
 
     LCD.Clear();
-    textLine(percent < 0 ? "turn left" : "turn right", 0);
+    textLine(percent < 0_pct ? "turn left" : "turn right", 0);
     // sleep(1.0);
 
 
-    // calculate expected encoder counts using math
-    double radians = degrees * PI / 180;
-    int expectedCounts = (double)ONE_REVOLUTION_COUNTS * ((WHEEL_DISTANCE / 2) * radians) / 2 / PI / WHEEL_RADIUS;
-
-
     resetCounts();
 
 
-    right_motor.SetPercent(-percent);
-    left_motor.SetPercent(leftMultiplier*percent);
+    drive(-percent, percent * leftMultiplier);
 
 
     double nextTime = 0;
     double startTime = TimeNow();
     while(true) {
         update();
-        int counts = getCounts();
+        Counts counts = getCounts();
         if (TimeNow() > nextTime) {
-            textLine("counts", counts, 1);
-            textLine("expected", expectedCounts, 2);
+            textLine("counts", counts.value, 1);
+            textLine("expected", expectedCounts.value, 2);
             textLine("time", TimeNow() - startTime, 3);
             if (TimeNow() > startTime + TIME_OUT) {
+                record_fault("turn timed out");
                 break;
             }
             if (counts >= expectedCounts) {
@@ -265,14 +386,19 @@ void turn_right(int percent, double degrees)
     }
 
 
-    right_motor.Stop();
-    left_motor.Stop();
+    stop_driving();
+}
+
+// turn right `degrees` degrees with motor power `percent` using shaft encoding
+// (converted to counts when this is called, like move_forward(Percent, Inches))
+inline void turn_right(Percent percent, Degrees degrees) {
+    turn_right(percent, to_counts(degrees));
 }
 
 // turn left `degrees` degrees with motor power `percent` using shaft encoding
-void turn_left(int percent, double degrees)
+inline void turn_left(Percent percent, Degrees degrees)
 {
-    turn_right(-percent, degrees);
+    turn_right(-percent, to_counts(degrees));
 }
 
 // sleep for `sec` seconds. call update during this
@@ -335,7 +461,7 @@ double rps_y() {
 /* Defines for how long each pulse should be and at what motor power.
 These value will normally be small, but you should play around with the values to find what works best */
 const double PULSE_TIME = 0.15;
-const double PULSE_POWER = 25;
+constexpr Percent PULSE_POWER = 25_pct;
 const double REGULAR_PULSE_TURN_TIME = 0.1;
 const double PLUS = 1;
 const double MINUS = -1;
@@ -343,41 +469,91 @@ const double MINUS = -1;
 /*
  * Pulse forward a short distance using time
  */
-void pulse_forward(int percent, float seconds)
+void pulse_forward(Percent percent, float seconds)
 {
     // Set both motors to desired percent
-    right_motor.SetPercent(percent);
-    left_motor.SetPercent(percent);
+    drive(percent, percent);
 
     // Wait for the correct number of seconds
     sleep(seconds);
 
     // Turn off motors
-    right_motor.Stop();
-    left_motor.Stop();
+    stop_driving();
 }
 
-void pulse_turn(int percent, float seconds) {
+void pulse_turn(Percent percent, float seconds) {
     // Set both motors to desired percent
-    right_motor.SetPercent(percent);
-    left_motor.SetPercent(-percent);
+    drive(percent, -percent);
 
     // Wait for the correct number of seconds
     sleep(seconds);
 
     // Turn off motors
-    right_motor.Stop();
-    left_motor.Stop();
+    stop_driving();
 }
 
 // Set the threshold for RPS check x and check y.
 const double threshold = 0.5;
 
-void check_x(float x_coordinate, int orientation)
+// Set the threshold for check heading, in degrees.
+const double HEADING_THRESHOLD = 2;
+
+// how precise an alignment call needs to be. every check_x, check_y and check_heading call
+// says which it needs. the governor only loosens NORMAL and COARSE alignments when the run
+// falls behind, and only lets them skip pulses and settling when it's far behind. FINE ones
+// keep their threshold and pulses and only get fewer iterations
+enum Precision { FINE, NORMAL, COARSE };
+
+// loosest threshold each Precision accepts when the run is behind, in inches and degrees
+const double LOOSEST_THRESHOLD[] = {threshold, 1.0, 2.0};
+const double LOOSEST_HEADING_THRESHOLD[] = {HEADING_THRESHOLD, 4.0, 7.5};
+
+// how many seconds past its deadline a task can be before the governor
+// stops just loosening alignments and starts cutting them short
+const double FAR_BEHIND_SECONDS = 8.0;
+
+// how many iterations an alignment gets when the run is far behind
+const int FAR_BEHIND_ITERATIONS = 3;
+
+// when the current course task should be finished by, set by course()
+// (it includes the budgets of every task before it, so time lost earlier counts against it)
+double taskDeadline = 1e9;
+
+// how an alignment call should run, picked by govern()
+struct Alignment {
+    double threshold;
+    int maxIterations;
+    // skip settling time and correct with one encoder move instead of pulses
+    bool fast;
+};
+
+// decide how an alignment call named `what` that needs `precision` should run, given how far
+// behind the run is. `tight` and `loosest` are the thresholds to use on time and when behind
+Alignment govern(const char *what, Precision precision, double tight, double loosest, int maxIterations) {
+    Alignment alignment = {tight, maxIterations, false};
+    double late = TimeNow() - taskDeadline;
+    if (late > 0 && precision != FINE) {
+        alignment.threshold = loosest;
+        alignment.maxIterations = maxIterations / 2;
+    }
+    if (late > FAR_BEHIND_SECONDS) {
+        if (alignment.maxIterations > FAR_BEHIND_ITERATIONS) {
+            alignment.maxIterations = FAR_BEHIND_ITERATIONS;
+        }
+        // FINE alignments keep their pulses and settling time, which is what makes them fine
+        alignment.fast = precision != FINE;
+    }
+    SD.FPrintf(log_file, "# governor: %s, precision %d, late %f s, threshold %f, iterations %d, fast %d\n",
+               what, (int)precision, late, alignment.threshold, alignment.maxIterations, (int)alignment.fast);
+    return alignment;
+}
+
+void check_x(float x_coordinate, int orientation, Precision precision)
 {
     textLine("check_x", 0);
+    Alignment alignment = govern("check_x", precision, threshold, LOOSEST_THRESHOLD[precision], CHECK_TIMES);
     // Determine the direction of the motors based on the orientation of the QR code
-    int power = PULSE_POWER;
+    Percent power = PULSE_POWER;
     if (orientation == MINUS)
     {
         power = -PULSE_POWER;
@@ -386,11 +562,22 @@ void check_x(float x_coordinate, int orientation)
     // Check if receiving proper RPS coordinates and whether the robot is within an acceptable range
     double current_x;
     int i = 0;
-    while (current_x = rps_x(), x_coordinate >= 0 && (current_x < x_coordinate - threshold || current_x > x_coordinate + threshold) && i < CHECK_TIMES)
+    while (current_x = rps_x(), x_coordinate >= 0 && (current_x < x_coordinate - alignment.threshold || current_x > x_coordinate + alignment.threshold) && i < alignment.maxIterations)
     {
         SD.FPrintf(log_file, "# current x: %f, target x: %f\n", current_x, x_coordinate);
+        if (current_x < 0) {
+            // don't pulse towards a position RPS didn't give
+            record_fault("rps x failed");
+            return;
+        }
         i++;
-        if (current_x > x_coordinate)
+        if (alignment.fast)
+        {
+            textLine("moving to x", 2);
+            // Drive the whole error at once instead of pulsing
+            move_forward(PULSE_POWER, Inches(orientation * (x_coordinate - current_x)));
+        }
+        else if (current_x > x_coordinate)
         {
             textLine("moving backward", 2);
             // Pulse the motors for a short duration in the correct direction
@@ -403,16 +590,20 @@ void check_x(float x_coordinate, int orientation)
             pulse_forward(power, PULSE_TIME);
         }
     }
+    if (i == alignment.maxIterations && std::abs(current_x - x_coordinate) > alignment.threshold) {
+        record_fault("check_x gave up");
+    }
 }
 
 
 /*
  * Use RPS to move to the desired y_coordinate based on the orientation of the QR code
  */
-void check_y(float y_coordinate, int orientation)
+void check_y(float y_coordinate, int orientation, Precision precision)
 {
+    Alignment alignment = govern("check_y", precision, threshold, LOOSEST_THRESHOLD[precision], CHECK_TIMES);
     // Determine the direction of the motors based on the orientation of the QR code
-    int power = PULSE_POWER;
+    Percent power = PULSE_POWER;
     if (orientation == MINUS)
     {
         power = -PULSE_POWER;
@@ -421,10 +612,21 @@ void check_y(float y_coordinate, int orientation)
     // Check if receiving proper RPS coordinates and whether the robot is within an acceptable range
     double current_y;
     int i = 0;
-    while (current_y = rps_y(), y_coordinate >= 0 && (current_y < y_coordinate - threshold || current_y > y_coordinate + threshold) && i < CHECK_TIMES) {
+    while (current_y = rps_y(), y_coordinate >= 0 && (current_y < y_coordinate - alignment.threshold || current_y > y_coordinate + alignment.threshold) && i < alignment.maxIterations) {
         SD.FPrintf(log_file, "# current y: %f, target y: %f\n", current_y, y_coordinate);
+        if (current_y < 0) {
+            // don't pulse towards a position RPS didn't give
+            record_fault("rps y failed");
+            return;
+        }
         i++;
-        if (current_y > y_coordinate)
+        if (alignment.fast)
+        {
+            textLine("moving to y", 2);
+            // Drive the whole error at once instead of pulsing
+            move_forward(PULSE_POWER, Inches(orientation * (y_coordinate - current_y)));
+        }
+        else if (current_y > y_coordinate)
         {
             textLine("moving backward", 2);
             // LCD.WriteLine(rps_y());
@@ -438,55 +640,254 @@ void check_y(float y_coordinate, int orientation)
             pulse_forward(power, PULSE_TIME);
         }
     }
+    if (i == alignment.maxIterations && std::abs(current_y - y_coordinate) > alignment.threshold) {
+        record_fault("check_y gave up");
+    }
+}
+
+// get the signed difference `current - target` in degrees, wrapped into [-180, 180]
+// (positive means the robot needs to turn right)
+double heading_difference(double currentHeading, double targetHeading) {
+    double difference = currentHeading - targetHeading;
+    if (difference < -180) {
+        difference += 360;
+    }
+    if (difference > 180) {
+        difference -= 360;
+    }
+    return difference;
+}
+
+// file on the SD card the turn model is saved to, so it carries over between runs
+// (a new name, since models saved without a dead time don't fit this one)
+const char *TURN_MODEL_FILE = "turnmdl2.txt";
+
+// how far one pulse_turn turns the robot, learned from what each pulse actually did.
+// a pulse of `seconds` at motor power `percent` is modeled as turning
+// `degreesPerSecond * (seconds - deadTime)` degrees, where `deadTime` is how long
+// the motors take to beat friction and start the robot turning
+struct TurnRate {
+    int percent;
+    double degreesPerSecond;
+    double deadTime;
+
+    // weighted sums of the pulses (seconds, degrees) that turned, for fitting the line
+    // degrees = degreesPerSecond * (seconds - deadTime) through them. not saved
+    double weight;
+    double sumSeconds;
+    double sumDegrees;
+    double sumSecondsSquared;
+    double sumSecondsDegrees;
+};
+
+// one learned rate per motor power check_heading has been called with
+std::vector<TurnRate> turnModel;
+
+// set when turnModel changes and hasn't been saved yet
+bool turnModelChanged = false;
+
+// how much the weight of the earlier pulses in the fit is kept with each new one
+// (1 never forgets, 0 only trusts the latest pulse)
+const double TURN_MODEL_MEMORY = 0.8;
+
+// pulse times the fit starts with points at, on the saved (or guessed) model, so one
+// pulse can't swing it far. they're forgotten like real pulses
+const double TURN_MODEL_SEED_TIMES[] = {0.1, 0.3};
+
+// a pulse that turned more than 4 times what the model expected probably hit
+// something or got a bad RPS reading, so it isn't learned from
+const double TURN_MODEL_OVERSHOOT_RATIO = 4;
+
+// how far RPS headings wander between readings while the robot is still, in degrees.
+// a pulse that turned less than this (either way) just didn't turn
+const double RPS_HEADING_NOISE = 1.0;
+
+// the heading errors a pulse time passed to check_heading was tuned for (the middle of the short pulse band)
+const double TUNED_PULSE_DEGREES = 6.0;
+
+// shortest and longest pulse check_heading will use
+const double MIN_PULSE_TURN_TIME = 0.02;
+const double MAX_PULSE_TURN_TIME = 0.5;
+
+// add a pulse of `seconds` that turned `degrees` degrees to the fit, counting `weight` times
+void add_to_turn_fit(TurnRate &rate, double seconds, double degrees, double weight) {
+    rate.weight += weight;
+    rate.sumSeconds += weight * seconds;
+    rate.sumDegrees += weight * degrees;
+    rate.sumSecondsSquared += weight * seconds * seconds;
+    rate.sumSecondsDegrees += weight * seconds * degrees;
+}
+
+// start the fit for `rate` from its current rate and dead time
+void seed_turn_fit(TurnRate &rate) {
+    for (double seconds : TURN_MODEL_SEED_TIMES) {
+        add_to_turn_fit(rate, seconds, rate.degreesPerSecond * (seconds - rate.deadTime), 1);
+    }
+}
+
+// read the turn model saved by a previous run, if there is one
+void load_turn_model() {
+    FEHFile *file = SD.FOpen(TURN_MODEL_FILE, "r");
+    if (!file) {
+        return;
+    }
+    int percent;
+    double degreesPerSecond, deadTime;
+    while (!SD.FEof(file) && SD.FScanf(file, "%d %lf %lf", &percent, &degreesPerSecond, &deadTime) == 3) {
+        if (degreesPerSecond > 0 && deadTime >= 0) {
+            turnModel.push_back({percent, degreesPerSecond, deadTime, 0, 0, 0, 0, 0});
+            seed_turn_fit(turnModel.back());
+        }
+    }
+    SD.FClose(file);
+}
+
+// write the turn model to the SD card if it has changed
+// (called once at the end of the run so check_heading doesn't wait on the SD card)
+void save_turn_model() {
+    if (!turnModelChanged) {
+        return;
+    }
+    FEHFile *file = SD.FOpen(TURN_MODEL_FILE, "w");
+    if (!file) {
+        return;
+    }
+    for (const TurnRate &rate : turnModel) {
+        SD.FPrintf(file, "%d %f %f\n", rate.percent, rate.degreesPerSecond, rate.deadTime);
+    }
+    SD.FClose(file);
+    turnModelChanged = false;
+}
+
+// get the learned rate for motor power `percent`
+// if there isn't one yet, guess it from a pulse time that was tuned by hand for that power
+// (with no dead time, which the first pulses that don't turn will fix)
+TurnRate &turn_rate(Percent power, double tunedPulseTime) {
+    int percent = std::abs((int)power.value);
+    for (TurnRate &rate : turnModel) {
+        if (rate.percent == percent) {
+            return rate;
+        }
+    }
+    turnModel.push_back({percent, TUNED_PULSE_DEGREES / tunedPulseTime, 0, 0, 0, 0, 0, 0});
+    seed_turn_fit(turnModel.back());
+    turnModelChanged = true;
+    return turnModel.back();
 }
 
-// Make sure that heading is correct by calculating the difference between the current and target headings. Pulse until the current heading is less than 2 degrees away from the target heading.
-void check_heading(double targetHeading, int percent, double pulseTime = REGULAR_PULSE_TURN_TIME, double threshold = 2) {
-    for (int i = 0; i < 100; i++) {
+// how long to pulse to turn `degrees` degrees at `rate`
+double pulse_time_for(const TurnRate &rate, double degrees) {
+    double seconds = rate.deadTime + std::abs(degrees) / rate.degreesPerSecond;
+    if (seconds < MIN_PULSE_TURN_TIME) {
+        return MIN_PULSE_TURN_TIME;
+    }
+    if (seconds > MAX_PULSE_TURN_TIME) {
+        return MAX_PULSE_TURN_TIME;
+    }
+    return seconds;
+}
+
+// update `rate` with a pulse of `seconds` that turned the robot `degrees` degrees in the intended direction.
+// a pulse that didn't turn only says the dead time is at least that long, so it lengthens the dead
+// time and leaves the rate alone. pulses that turned are fit with a line, which gives both
+void learn_turn_rate(TurnRate &rate, double seconds, double degrees) {
+    double turning = seconds - rate.deadTime;
+    if (turning < MIN_PULSE_TURN_TIME) {
+        turning = MIN_PULSE_TURN_TIME;
+    }
+    if (degrees < -RPS_HEADING_NOISE || degrees / turning > rate.degreesPerSecond * TURN_MODEL_OVERSHOOT_RATIO) {
+        SD.FPrintf(log_file, "# turn model: ignoring %f deg in %f s at %d%%\n", degrees, seconds, rate.percent);
+        return;
+    }
+    if (degrees < RPS_HEADING_NOISE) {
+        if (seconds > rate.deadTime) {
+            rate.deadTime = seconds;
+        }
+    } else {
+        rate.weight *= TURN_MODEL_MEMORY;
+        rate.sumSeconds *= TURN_MODEL_MEMORY;
+        rate.sumDegrees *= TURN_MODEL_MEMORY;
+        rate.sumSecondsSquared *= TURN_MODEL_MEMORY;
+        rate.sumSecondsDegrees *= TURN_MODEL_MEMORY;
+        add_to_turn_fit(rate, seconds, degrees, 1);
+        // least squares line degrees = slope * seconds + intercept
+        double spread = rate.weight * rate.sumSecondsSquared - rate.sumSeconds * rate.sumSeconds;
+        if (spread <= 0) {
+            return;
+        }
+        double slope = (rate.weight * rate.sumSecondsDegrees - rate.sumSeconds * rate.sumDegrees) / spread;
+        double intercept = (rate.sumDegrees - slope * rate.sumSeconds) / rate.weight;
+        if (intercept > 0) {
+            // the robot can't turn before the pulse starts, so fit a line through zero instead
+            slope = rate.sumSecondsDegrees / rate.sumSecondsSquared;
+            intercept = 0;
+        }
+        if (slope <= 0) {
+            return;
+        }
+        rate.degreesPerSecond = slope;
+        rate.deadTime = -intercept / slope;
+    }
+    turnModelChanged = true;
+    SD.FPrintf(log_file, "# turn model: %d%% %f deg/s after %f s\n", rate.percent, rate.degreesPerSecond, rate.deadTime);
+}
+
+// Make sure that heading is correct by calculating the difference between the current and target headings.
+// Big differences are corrected with turn_right. Smaller ones get one pulse sized by the turn model,
+// and the next heading reading is used to improve the model for the next pulse at this power.
+// `pulseTime` is a hand tuned pulse for this power, only used before anything has been learned for it.
+void check_heading(double targetHeading, Percent percent, Precision precision, double pulseTime = REGULAR_PULSE_TURN_TIME) {
+    Alignment alignment = govern("check_heading", precision, HEADING_THRESHOLD, LOOSEST_HEADING_THRESHOLD[precision], CHECK_HEADING_TIMES);
+    TurnRate &rate = turn_rate(percent, pulseTime);
+    // the last pulse, so its result can be measured with the next reading
+    double lastHeading = -1;
+    double lastPulseTime = 0;
+    double lastDirection = 0;
+    for (int i = 0; i < alignment.maxIterations; i++) {
         double currentHeading = rps_heading();
         SD.FPrintf(log_file, "# current h: %f, target h: %f\n", currentHeading, targetHeading);
         textLine("target h", targetHeading, 8);
         textLine("current h", currentHeading, 7);
         if (currentHeading < 0) {
-            return;
+            record_fault("rps heading failed");
+            break;
         }
-        double difference = currentHeading - targetHeading;
-        if (difference < -180) {
-            difference += 360;
+        if (lastPulseTime > 0 && lastHeading >= 0) {
+            learn_turn_rate(rate, lastPulseTime, lastDirection * heading_difference(currentHeading, lastHeading));
         }
-        if (difference > 180) {
-            difference -= 360;
+        lastPulseTime = 0;
+        double difference = heading_difference(currentHeading, targetHeading);
+        if (std::abs(difference) < alignment.threshold) {
+            break;
         }
-        if (std::abs(difference) < threshold) {
-            return;
+        if (i == alignment.maxIterations - 1) {
+            record_fault("check_heading gave up");
+            break;
         }
 
         if (std::abs(difference) > 7.5) {
             SD.FPrintf(log_file, "using big pulse\n");
-            turn_right(percent, difference);
+            turn_right(percent, Degrees(difference));
         } else {
             if (std::abs(difference) < 4.5) {
                 SD.FPrintf(log_file, "using tiny pulse\n");
-                pulseTime *= .7;
             } else {
                 SD.FPrintf(log_file, "using short pulse\n");
             }
-            if (difference < 0) {
-                pulse_turn(percent, pulseTime);
-            } else {
-                pulse_turn(-percent, pulseTime);
-            }
-            if (std::abs(difference) < 4.5) {
+            // a positive pulse_turn turns left, which makes the heading bigger
+            lastDirection = difference < 0 ? 1 : -1;
+            lastPulseTime = pulse_time_for(rate, difference);
+            lastHeading = currentHeading;
+            SD.FPrintf(log_file, "# pulse: %f s at %d%%\n", lastPulseTime, (int)percent.value);
+            pulse_turn(percent * lastDirection, lastPulseTime);
+            if (std::abs(difference) < 4.5 && !alignment.fast) {
                 sleep(0.2);
             }
         }
-        // if (std::abs(difference) < 5) {
-        //     sleep(0.3);
-        // }
     }
 }
 
-void check_heading_once(double targetHeading, int percent) {
+void check_heading_once(double targetHeading, Percent percent) {
     sleep(.2);
     double currentHeading = rps_heading();
     SD.FPrintf(log_file, "# current h: %f, target h: %f\n", currentHeading, targetHeading);
@@ -495,14 +896,8 @@ void check_heading_once(double targetHeading, int percent) {
     if (currentHeading < 0) {
         return;
     }
-    double difference = currentHeading - targetHeading;
-    if (difference < -180) {
-        difference += 360;
-    }
-    if (difference > 180) {
-        difference -= 360;
-    }
-    turn_right(percent, difference);
+    double difference = heading_difference(currentHeading, targetHeading);
+    turn_right(percent, Degrees(difference));
 }
 
 // Deposit the luggage into the top bin and prepare for the next task.
@@ -510,57 +905,61 @@ void luggage() {
     // Wait for the light.
     wait_for_light();
     // Move forward.
-    move_forward(80, 8.25);
+    move_forward(80_pct, 8.25_in);
 
     // Set the luggage turn and check heading powers.
-    double luggage_turn_power = 55.0;
-    double luggage_check_heading_power = 30.0;
+    constexpr Percent luggage_turn_power = 55_pct;
+    constexpr Percent luggage_check_heading_power = 30_pct;
     double luggage_check_heading_time = .225;
 
     // align with right wall
-    turn_left(luggage_turn_power, 45);
-    check_heading(HEADING_LEFT, luggage_check_heading_power, luggage_check_heading_time);
-    move_backward(80, 18-4);
-    move_backward(40, 5);
+    turn_left(luggage_turn_power, 45_deg);
+    check_heading(HEADING_LEFT, luggage_check_heading_power, COARSE, luggage_check_heading_time);
+    constexpr Counts back_to_wall = route_counts(18_in - 4_in);
+    move_backward(80_pct, back_to_wall);
+    move_backward(40_pct, 5_in);
 
     // go up ramp
+    constexpr Counts ramp_turn = route_counts(90_deg * 1.65);
     if (RPS.CurrentRegionLetter() == 'C') {
-        move_forward(25, 1.5);
-        turn_right(80.0, 90*1.65);
+        move_forward(25_pct, 1.5_in);
+        turn_right(80.0_pct, ramp_turn);
     } else {
-        move_forward(25, .5);
-        turn_right(80.0, 90*1.65);
+        move_forward(25_pct, .5_in);
+        turn_right(80.0_pct, ramp_turn);
     }
-    check_heading(HEADING_UP, luggage_check_heading_power, luggage_check_heading_time);
-    move_forward(80, 6 + 12.31 + 3 + 2 + 2 + 2 + 2);
-    check_y(45.3 + 3 - 2 + 2 - 1 - .75 - 1.0, PLUS);
+    check_heading(HEADING_UP, luggage_check_heading_power, NORMAL, luggage_check_heading_time);
+    constexpr Counts up_ramp = route_counts(6_in + 12.31_in + 3_in + 2_in + 2_in + 2_in + 2_in);
+    move_forward(80_pct, up_ramp);
+    check_y(45.3 + 3 - 2 + 2 - 1 - .75 - 1.0, PLUS, NORMAL);
 
     // Turn left and make sure the robot has the left heading
-    turn_left(luggage_turn_power, 90);
-    check_heading(HEADING_LEFT, 50);
-    // move_backward(40, 10);
+    turn_left(luggage_turn_power, 90_deg);
+    check_heading(HEADING_LEFT, 50_pct, COARSE);
+    // move_backward(40_pct, 10_in);
 
     // Get next to luggage bin
     double difference = -1.0;
 
-    move_forward(luggage_turn_power, 5 + 9 - .5 - 1.5 - 1.5 - 1 + 2);
-    check_x(16+difference+2+1.5-1-.25-.5, MINUS);
+    constexpr Counts to_luggage_bin = route_counts(5_in + 9_in - .5_in - 1.5_in - 1.5_in - 1_in + 2_in);
+    move_forward(luggage_turn_power, to_luggage_bin);
+    check_x(16+difference+2+1.5-1-.25-.5, MINUS, NORMAL);
 
     // Make sure to position properly and accurately in front of the luggage deposit
     if (RPS.CurrentRegionLetter() == 'D') {
-        turn_left(70, 90);
-        check_heading((HEADING_DOWN + HEADING_LEFT)/2, 45, luggage_check_heading_time);
-        check_x(16+difference+2-1-1-.25, MINUS);
-        check_heading(HEADING_DOWN, 45, luggage_check_heading_time);
+        turn_left(70_pct, 90_deg);
+        check_heading((HEADING_DOWN + HEADING_LEFT)/2, 45_pct, NORMAL, luggage_check_heading_time);
+        check_x(16+difference+2-1-1-.25, MINUS, FINE);
+        check_heading(HEADING_DOWN, 45_pct, FINE, luggage_check_heading_time);
     } else {
-        turn_left(60, 90);
-        check_heading((HEADING_DOWN + HEADING_LEFT)/2, luggage_check_heading_power, luggage_check_heading_time);
-        check_x(16+difference+2-1-1-.25, MINUS);
-        check_heading(HEADING_DOWN, luggage_check_heading_power, luggage_check_heading_time);
+        turn_left(60_pct, 90_deg);
+        check_heading((HEADING_DOWN + HEADING_LEFT)/2, luggage_check_heading_power, NORMAL, luggage_check_heading_time);
+        check_x(16+difference+2-1-1-.25, MINUS, FINE);
+        check_heading(HEADING_DOWN, luggage_check_heading_power, FINE, luggage_check_heading_time);
     }
 
     // Move forward slightly
-    move_forward(80, 2.25);
+    move_forward(80_pct, 2.25_in);
 
     // Gradually move arm down to deposit luggage
     for (int i = 0; i < 140; i += 140/5) {
@@ -569,177 +968,366 @@ void luggage() {
     }
 }
 
+// y passport_flip aligns to facing down, which kiosk_buttons then relies on
+const double PASSPORT_Y = 59.09 - 2.5;
+
+// y kiosk_buttons aligns to facing down at the bottom of the ramp, which fuel_levers then relies on
+const double RAMP_BOTTOM_Y = 21 + .5;
+
 // Flip the passport stamp
 void passport_flip() {
     // Move backward and put servo arm all the way up
-    move_backward(40, 4);
+    move_backward(40_pct, 4_in);
     arm_servo.SetDegree(0);
 
     // Move backward and check y
-    move_backward(40, 5 + 4.4 - 3);
-    check_y(59.09 - 2.5, MINUS);
+    constexpr Counts back_from_passport = route_counts(5_in + 4.4_in - 3_in);
+    move_backward(40_pct, back_from_passport);
+    check_y(PASSPORT_Y, MINUS, FINE);
 
     // Make sure the arm servo's been set to all the way down for passport stamp flipping
     arm_servo.SetDegree(ALL_THE_WAY_DOWN);
 
     // Turn left and make sure the heading is set to heading right.
-    turn_left(25, 90);
-    check_heading(HEADING_RIGHT, regular_check_heading_power);
-    // move_forward(25, 0.5);
+    turn_left(25_pct, 90_deg);
+    check_heading(HEADING_RIGHT, regular_check_heading_power, FINE);
+    // move_forward(25_pct, 0.5_in);
 
     // Move forward
-    move_forward(40, 7.5+0.5 - 2 - 2 + 1.3 + 1.5);
+    constexpr Counts forward_to_kiosk = route_counts(7.5_in + 0.5_in - 2_in - 2_in + 1.3_in + 1.5_in);
+    move_forward(40_pct, forward_to_kiosk);
 
     // Prepare for kiosk button selection
     arm_servo.SetDegree(0);
-    move_forward(25, 1);
-    move_backward(40, 3);
+    move_forward(25_pct, 1_in);
+    move_backward(40_pct, 3_in);
     arm_servo.SetDegree(0);
 }
 
 // Press the correct kiosk button based on the correct CdS cell reading
 void kiosk_buttons() {
     // Move backward toward the kiosk.
-    check_heading(HEADING_RIGHT, regular_check_heading_power);
-    move_backward(40, 1 + 1 + 0.5 + 0.5);
+    check_heading(HEADING_RIGHT, regular_check_heading_power, NORMAL);
+    constexpr Counts back_to_kiosk = route_counts(1_in + 1_in + 0.5_in + 0.5_in);
+    move_backward(40_pct, back_to_kiosk);
 
     // Correctly position to go over the light
-    check_x(11.4 + 1.5 - 1.5 + 0.75-0.5 - 0.5 - 0.5 + .5, PLUS);
+    check_x(11.4 + 1.5 - 1.5 + 0.75-0.5 - 0.5 - 0.5 + .5, PLUS, FINE);
 
     // Turn left and make sure heading is up
     if (RPS.CurrentRegionLetter() == 'A') {
-        turn_left(90, 90);
+        turn_left(90_pct, 90_deg);
     } else {
-        turn_left(60, 90);
+        turn_left(60_pct, 90_deg);
     }
-    check_heading(HEADING_UP, regular_check_heading_power);
+    check_heading(HEADING_UP, regular_check_heading_power, NORMAL);
     // check heading twice for more accuracy
-    check_heading(HEADING_UP, regular_check_heading_power);
+    check_heading(HEADING_UP, regular_check_heading_power, NORMAL);
 
     // Set the red boolean to false
     red = false;
 
     // Move forward to position properly for kiosk light button pushing
-    // move_forward(10, 4);
-    left_motor.SetPercent(10);
-    right_motor.SetPercent(10);
+    // move_forward(10_pct, 4_in);
+    drive(10_pct, 10_pct);
     sleep(4);
-    left_motor.Stop();
-    right_motor.Stop();
+    stop_driving();
 
     if (red) {
         // red light case - approach the red button on the kiosk and press it by gently running into it
         colorString = "color: RED";
-        move_backward(50, 15);
-        turn_right(35, 90);
-        check_heading(HEADING_RIGHT, regular_check_heading_power);
-        move_forward(50, 10.5 - 2 - 1 + 2);
-        check_x(23, PLUS);
-        turn_left(35, 90);
-        check_heading(HEADING_UP, regular_check_heading_power);
-        move_forward(50, 20 - 2);
-        move_backward(50, 4);
+        move_backward(50_pct, 15_in);
+        turn_right(35_pct, 90_deg);
+        check_heading(HEADING_RIGHT, regular_check_heading_power, NORMAL);
+        constexpr Counts to_red_button = route_counts(10.5_in - 2_in - 1_in + 2_in);
+        move_forward(50_pct, to_red_button);
+        check_x(23, PLUS, FINE);
+        turn_left(35_pct, 90_deg);
+        check_heading(HEADING_UP, regular_check_heading_power, NORMAL);
+        constexpr Counts up_to_red_button = route_counts(20_in - 2_in);
+        move_forward(50_pct, up_to_red_button);
+        move_backward(50_pct, 4_in);
     } else {
         // blue light case - approach the blue button on the kiosk and press it by gently running into it
         colorString = "color: BLUE";
-        move_backward(50, 5);
-        turn_right(35, 90);
-        check_heading(HEADING_RIGHT, regular_check_heading_power);
-        move_forward(50, 4);
-        turn_left(35, 90);
-        check_heading(HEADING_UP, regular_check_heading_power);
-
-        move_forward(50, 7);
-        move_backward(50, 4);
+        move_backward(50_pct, 5_in);
+        turn_right(35_pct, 90_deg);
+        check_heading(HEADING_RIGHT, regular_check_heading_power, NORMAL);
+        move_forward(50_pct, 4_in);
+        turn_left(35_pct, 90_deg);
+        check_heading(HEADING_UP, regular_check_heading_power, NORMAL);
+
+        move_forward(50_pct, 7_in);
+        move_backward(50_pct, 4_in);
     }
 
 
     // move back
-    turn_left(35, 110);
-    check_heading(110, 35);
+    turn_left(35_pct, 110_deg);
+    check_heading(110, 35_pct, COARSE);
 
-    move_forward(60, 15);
-    // turn_right(35, 45);
+    move_forward(60_pct, 15_in);
+    // turn_right(35_pct, 45_deg);
     // align with left wall
-    // turn_left(35, 90);
-    // check_heading(HEADING_LEFT, regular_check_heading_power);
+    // turn_left(35_pct, 90_deg);
+    // check_heading(HEADING_LEFT, regular_check_heading_power, NORMAL);
     // if (red) {
-    //     move_forward(40, 18);
+    //     move_forward(40_pct, 18_in);
     // } else {
-    //     move_forward(40, 18-5.5);
+    //     move_forward(40_pct, 18_in - 5.5_in);
     // }
 
     // Face the downward direction to go down the ramp
-    turn_left(35, 50);
-    move_forward(35, 1.5);
-    turn_left(35, 20);
-    check_heading(HEADING_DOWN, regular_check_heading_power);
+    turn_left(35_pct, 50_deg);
+    move_forward(35_pct, 1.5_in);
+    turn_left(35_pct, 20_deg);
+    check_heading(HEADING_DOWN, regular_check_heading_power, NORMAL);
 
 
     // Go down the ramp
-    move_forward(60, 12+3+3+2.5-.5 - 4);
-    check_y(21+.5, MINUS);
+    constexpr Counts down_ramp = route_counts(12_in + 3_in + 3_in + 2.5_in - .5_in - 4_in);
+    move_forward(60_pct, down_ramp);
+    check_y(RAMP_BOTTOM_Y, MINUS, NORMAL);
 
     // Turn left and check heading to prepare for the fuel lever task
-    turn_left(25, 90);
-    check_heading(HEADING_RIGHT, regular_check_heading_power);
+    turn_left(25_pct, 90_deg);
+    check_heading(HEADING_RIGHT, regular_check_heading_power, NORMAL);
 }
 
 void fuel_levers() {
     // Determine the correct distance to move based on the correct fuel lever
-    double distance;
+    Inches distance = 0_in;
     if (fuel_lever == 2) {
-        distance = 3.5;
+        distance = 3.5_in;
     } else if (fuel_lever == 1) {
-        distance = 7.0;
+        distance = 7.0_in;
     } else if (fuel_lever == 0) {
-        distance = 10.5;
+        distance = 10.5_in;
     }
     // Approach the correct fuel lever
-    move_forward(25, distance-5);
-    check_x(2.5+distance, PLUS);
-    turn_right(25, 90);
-    check_heading(HEADING_DOWN, regular_check_heading_power);
-    move_backward(25, 1.5);
+    move_forward(25_pct, distance - 5_in);
+    check_x(2.5+distance.value, PLUS, FINE);
+    turn_right(25_pct, 90_deg);
+    check_heading(HEADING_DOWN, regular_check_heading_power, FINE);
+    move_backward(25_pct, 1.5_in);
     // Flipping the correct lever down
     arm_servo.SetDegree(100);
-    move_backward(25, 3);
+    move_backward(25_pct, 3_in);
     arm_servo.SetDegree(100);
     // Wait five seconds for the airplane to be fueled, and flip the fuel lever back up
     double startTime = TimeNow();
     arm_servo.SetDegree(ALL_THE_WAY_DOWN);
-    check_heading(HEADING_DOWN, regular_check_heading_power);
+    check_heading(HEADING_DOWN, regular_check_heading_power, NORMAL);
     sleep(5.0 - (TimeNow() - startTime));
-    move_forward(25, 2.15);
+    move_forward(25_pct, 2.15_in);
     arm_servo.SetDegree(0);
     sleep(0.3);
     // Approach the ramp on the right side of the course
     arm_servo.SetDegree(ALL_THE_WAY_DOWN);
-    turn_left(25, 90);
-    check_heading(HEADING_RIGHT, regular_check_heading_power);
-    move_forward(60, 10-distance);
+    turn_left(25_pct, 90_deg);
+    check_heading(HEADING_RIGHT, regular_check_heading_power, NORMAL);
+    move_forward(60_pct, 10_in - distance);
     // Put up the servo arm
     arm_servo.SetDegree(0);
 
     // Get into the x position sufficient for turning and approaching the final button.
-    check_x(11.65+3-1, PLUS);
-    turn_right(25, 45);
+    check_x(11.65+3-1, PLUS, NORMAL);
+    turn_right(25_pct, 45_deg);
     // Check heading making the robot face the final button
-    check_heading((HEADING_DOWN+HEADING_RIGHT)/2, regular_check_heading_power);
+    check_heading((HEADING_DOWN+HEADING_RIGHT)/2, regular_check_heading_power, NORMAL);
     // Move forward into the final button
-    move_forward(80, 30);
+    move_forward(80_pct, 30_in);
+}
+
+// a task in the course, how long it should take, and the pose it expects the robot to start in.
+// the pose is the x or y an earlier task aligned to and this one doesn't align itself, and the
+// heading it was aligned at, since RPS reads a different x and y after the robot turns.
+// negative values mean the task doesn't care (or sets them up itself)
+struct CourseTask {
+    const char *name;
+    void (*run)();
+    // seconds the task gets out of the two minute run, including recovering its pose
+    double budget;
+    // heading the task starts at
+    double heading;
+    // heading x and y are checked at
+    double checkHeading;
+    double x;
+    double y;
+};
+
+// the course, in order
+const CourseTask COURSE_TASKS[] = {
+    {"luggage", luggage, 35, -1, -1, -1, -1},
+    // luggage ends with the arm down in the bin, so the robot can't turn to check anything here
+    {"passport", passport_flip, 20, -1, -1, -1, -1},
+    // kiosk aligns its own x
+    {"kiosk", kiosk_buttons, 40, HEADING_RIGHT, HEADING_DOWN, -1, PASSPORT_Y},
+    // fuel levers aligns its own x
+    {"fuel levers", fuel_levers, 25, HEADING_RIGHT, HEADING_DOWN, -1, RAMP_BOTTOM_Y},
+};
+const int COURSE_TASK_COUNT = sizeof(COURSE_TASKS) / sizeof(COURSE_TASKS[0]);
+
+// how far off the start pose can be before course() tries to fix it
+const double POSE_POSITION_TOLERANCE = 1.0;
+
+// how many times course() tries to fix the pose before starting a task anyway
+const int MAX_RECOVERY_ATTEMPTS = 2;
+
+// how far to back up when RPS can't see the robot, in the hope that it can from there
+constexpr Inches RELOCALIZE_DISTANCE = 1.5_in;
+
+// what course() knows about the pose before a task
+enum PoseCheck { POSE_OK, POSE_OFF, POSE_LOST };
+
+// states of the course state machine
+enum CourseState { CHECK_POSE, RECOVER_POSE, RELOCALIZE, FACE_TASK, RUN_TASK, NEXT_TASK, FINISHED };
+
+// true if `task` expects an x or y it doesn't align itself
+bool has_pose(const CourseTask &task) {
+    return task.x >= 0 || task.y >= 0;
+}
+
+// turn to the heading `task`'s pose is checked at and compare the robot's x and y to it
+PoseCheck check_pose(const CourseTask &task) {
+    check_heading(task.checkHeading, regular_check_heading_power, NORMAL);
+    if (task.x >= 0) {
+        double x = rps_x();
+        if (x < 0) {
+            return POSE_LOST;
+        }
+        SD.FPrintf(log_file, "# pose x: %f, expected x: %f\n", x, task.x);
+        if (std::abs(x - task.x) > POSE_POSITION_TOLERANCE) {
+            return POSE_OFF;
+        }
+    }
+    if (task.y >= 0) {
+        double y = rps_y();
+        if (y < 0) {
+            return POSE_LOST;
+        }
+        SD.FPrintf(log_file, "# pose y: %f, expected y: %f\n", y, task.y);
+        if (std::abs(y - task.y) > POSE_POSITION_TOLERANCE) {
+            return POSE_OFF;
+        }
+    }
+    return POSE_OK;
+}
+
+// drive into the x and y `task` expects, at the heading check_pose left the robot at
+void recover_pose(const CourseTask &task) {
+    if (task.x >= 0) {
+        check_x(task.x, task.checkHeading == HEADING_RIGHT ? PLUS : MINUS, NORMAL);
+    }
+    if (task.y >= 0) {
+        check_y(task.y, task.checkHeading == HEADING_UP ? PLUS : MINUS, NORMAL);
+    }
 }
 
 // Course traversal function
-void course() {
-    // Complete luggage task
-    luggage();
-    // Complete passport flip task
-    passport_flip();
-    // Complete kiosk button task
-    kiosk_buttons();
-    // Complete fuel lever task
-    fuel_levers();
+// runs the tasks in order starting at `firstTask`. when a task records a fault, the next
+// task's pose is checked before it starts, with a bounded number of tries to recover it
+void course(int firstTask = 0) {
+    int task = firstTask;
+    int attempts = 0;
+    CourseState state = RUN_TASK;
+    if (courseStartTime < 0) {
+        courseStartTime = TimeNow();
+    }
+    taskDeadline = courseStartTime + COURSE_TASKS[task].budget;
+    while (state != FINISHED) {
+        const CourseTask &current = COURSE_TASKS[task];
+        switch (state) {
+        case CHECK_POSE: {
+            if (!has_pose(current)) {
+                SD.FPrintf(log_file, "# task %s: no pose to check\n", current.name);
+                state = RUN_TASK;
+                break;
+            }
+            PoseCheck pose = check_pose(current);
+            if (pose == POSE_OK) {
+                state = FACE_TASK;
+            } else if (attempts >= MAX_RECOVERY_ATTEMPTS) {
+                SD.FPrintf(log_file, "# task %s: starting without its pose\n", current.name);
+                state = FACE_TASK;
+            } else {
+                attempts++;
+                state = pose == POSE_LOST ? RELOCALIZE : RECOVER_POSE;
+            }
+            break;
+        }
+        case RECOVER_POSE:
+            SD.FPrintf(log_file, "# task %s: recovering pose\n", current.name);
+            recover_pose(current);
+            state = CHECK_POSE;
+            break;
+        case RELOCALIZE:
+            SD.FPrintf(log_file, "# task %s: relocalizing\n", current.name);
+            move_backward(25_pct, RELOCALIZE_DISTANCE);
+            state = CHECK_POSE;
+            break;
+        case FACE_TASK:
+            check_heading(current.heading, regular_check_heading_power, NORMAL);
+            state = RUN_TASK;
+            break;
+        case RUN_TASK:
+            SD.FPrintf(log_file, "# task: %s\n", current.name);
+            SD.FPrintf(log_file, "# schedule: %f s elapsed, deadline %f s\n", TimeNow() - courseStartTime, taskDeadline - courseStartTime);
+            SD.FPrintf(log_file, "# battery: %f V, compensation: %f\n", batteryVoltage, battery_compensation());
+            task_faults = 0;
+            current.run();
+            SD.FPrintf(log_file, "# task done: %s, faults: %d\n", current.name, task_faults);
+            state = NEXT_TASK;
+            break;
+        case NEXT_TASK:
+            task++;
+            attempts = 0;
+            if (task < COURSE_TASK_COUNT) {
+                taskDeadline += COURSE_TASKS[task].budget;
+                state = task_faults > 0 ? CHECK_POSE : RUN_TASK;
+            } else {
+                state = FINISHED;
+            }
+            break;
+        case FINISHED:
+            break;
+        }
+    }
+}
+
+// number of text rows on the screen
+const int LCD_ROWS = 14;
+
+// screen row of the first task in the start menu
+const int MENU_FIRST_ROW = 2;
+
+// show the course tasks and wait for one to be touched
+// the row under the tasks records the current battery voltage as the tuned voltage
+// returns the index of the task to start at
+int choose_start_task() {
+    float touchX, touchY;
+    LCD.Clear();
+    textLine("Touch a task to start at", 0);
+    for (int i = 0; i < COURSE_TASK_COUNT; i++) {
+        textLine(std::string("> ") + COURSE_TASKS[i].name, MENU_FIRST_ROW + i);
+    }
+    textLine("> record tuned voltage", MENU_FIRST_ROW + COURSE_TASK_COUNT);
+    textLine("tuned V", tunedBatteryVoltage, MENU_FIRST_ROW + COURSE_TASK_COUNT + 1);
+    while (true) {
+        while(LCD.Touch(&touchX,&touchY)); //Wait for screen to be unpressed
+        while(!LCD.Touch(&touchX,&touchY)) {
+            update();
+        };// Wait for screen to be pressed
+        while(LCD.Touch(&touchX,&touchY)); //Wait for screen to be unpressed
+        int task = (int)touchY * LCD_ROWS / LCD_HEIGHT - MENU_FIRST_ROW;
+        if (task >= 0 && task < COURSE_TASK_COUNT) {
+            return task;
+        }
+        if (task == COURSE_TASK_COUNT) {
+            save_tuned_voltage();
+            textLine("tuned V", tunedBatteryVoltage, MENU_FIRST_ROW + COURSE_TASK_COUNT + 1);
+        }
+    }
 }
 
 // Motor calibration function
@@ -749,7 +1337,7 @@ void calibrate_motors() {
     // Write that the motors are being calibrated.
     LCD.WriteLine("Calibrating motors");
     // Move forward 8 inches
-    move_forward(25, 8);
+    move_forward(25_pct, 8_in);
     // Clear the screen
     LCD.Clear();
     // Write the left and right encoder counts
@@ -766,12 +1354,17 @@ void calibrate_motors() {
 // Main function
 int main(void)
 {
-    // Set up floats for touch screen values
-    float touchX, touchY;
-
     // Open a log file
     log_file = SD.FOpen("log.csv", "w");
 
+    // Load what previous runs learned about pulse turns
+    load_turn_model();
+
+    // Load the battery voltage the robot was tuned at, and start the battery filter at the current voltage
+    load_tuned_voltage();
+    batteryVoltage = Battery.Voltage();
+    SD.FPrintf(log_file, "# battery: %f V, tuned at: %f V\n", batteryVoltage, tunedBatteryVoltage);
+
     // Clear the screen, setting the screen color to black and setting the font color to white
     LCD.Clear(BLACK);
     LCD.SetFontColor(WHITE);
@@ -786,13 +1379,8 @@ int main(void)
     // Initialize RPS.
     RPS.InitializeTouchMenu();
 
-    // Print a message saying to touch the screen and wait for screen touch
-    textLine("Touch the screen", 0);
-    while(LCD.Touch(&touchX,&touchY)); //Wait for screen to be unpressed
-    while(!LCD.Touch(&touchX,&touchY)) {
-        update();
-    };// Wait for screen to be pressed
-    while(LCD.Touch(&touchX,&touchY)); //Wait for screen to be unpressed
+    // Pick which task to start at, so practice runs can go straight to one
+    int startTask = choose_start_task();
 
     // Clear the screen.
     LCD.Clear();
@@ -802,7 +1390,10 @@ int main(void)
 
 //    fifth_performance_checkpoint();
     // calibrate_motors();
-    course();
+    course(startTask);
+
+    // Keep what this run learned about pulse turns for the next one
+    save_turn_model();
 
     SD.FClose(log_file);
 
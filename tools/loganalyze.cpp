@@ -0,0 +1,321 @@
+// Host tool that compares logs from several runs of the robot.
+//
+// Each run's log (LOG.CSV from the SD card) is split into course tasks at the
+// "# task:" lines course() writes. For every task it collects the position
+// samples, how many times check_x/check_y/check_heading read RPS, which
+// check_heading pulses were used, faults, and governor decisions. Runs from
+// before the task lines existed are treated as one task called "course".
+//
+// usage: loganalyze [--baseline RUN] [--tolerance FRACTION] [--dataset OUT.csv] [--samples OUT.csv] RUN...
+// the baseline defaults to the first run. exits with status 1 if any run
+// regressed against the baseline. --dataset writes one row per run and task,
+// --samples writes every sample (position, heading and CdS cell) labeled with its run and task.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// a position sample from update()
+struct Sample {
+    double time;
+    double x;
+    double y;
+    double heading;
+    double cds;
+};
+
+// everything one run logged during one task
+struct TaskLog {
+    std::string name;
+    std::vector<Sample> samples;
+    int xChecks = 0;
+    int yChecks = 0;
+    int headingChecks = 0;
+    int bigPulses = 0;
+    int shortPulses = 0;
+    int tinyPulses = 0;
+    int faults = 0;
+    // governor decisions made while the task was past its deadline
+    int lateDecisions = 0;
+
+    // seconds from the first to the last sample
+    double time() const {
+        return samples.size() < 2 ? 0 : samples.back().time - samples.front().time;
+    }
+
+    int alignments() const {
+        return xChecks + yChecks + headingChecks;
+    }
+};
+
+struct Run {
+    std::string path;
+    std::vector<TaskLog> tasks;
+
+    const TaskLog *task(const std::string &name) const {
+        for (const TaskLog &task : tasks) {
+            if (task.name == name) {
+                return &task;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// how many points trajectories are resampled to before comparing them
+const int TRAJECTORY_POINTS = 20;
+
+// a task whose path is further than this from the baseline's on average, in inches, is flagged
+const double DIVERGENCE_LIMIT = 2.0;
+
+// seconds a task may be slower than the baseline before the tolerance applies,
+// since samples are only logged every quarter second
+const double TIME_SLACK = 1.0;
+
+// alignment iterations a task may add before the tolerance applies
+const int ALIGNMENT_SLACK = 2;
+
+static bool starts_with(const char *line, const char *prefix) {
+    return std::strncmp(line, prefix, std::strlen(prefix)) == 0;
+}
+
+static Run read_run(const char *path) {
+    Run run;
+    run.path = path;
+    FILE *file = std::fopen(path, "r");
+    if (!file) {
+        std::fprintf(stderr, "loganalyze: can't open %s\n", path);
+        std::exit(2);
+    }
+    run.tasks.push_back(TaskLog());
+    run.tasks.back().name = "course";
+    // the sample before a "# task:" line is where that task starts
+    Sample last = {-1, -1, -1, -1, -1};
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        TaskLog *task = &run.tasks.back();
+        Sample sample;
+        char name[128];
+        if (std::sscanf(line, "%lf,%lf,%lf,%lf,%lf", &sample.time, &sample.x, &sample.y, &sample.heading, &sample.cds) == 5) {
+            task->samples.push_back(sample);
+            last = sample;
+        } else if (std::sscanf(line, "# task: %127[^\n]", name) == 1) {
+            if (task->name.empty()) {
+                // recovering the pose after the last task counts towards this one, like in course()
+                task->name = name;
+            } else {
+                // drop the placeholder if nothing happened before the first task
+                if (task->name == "course" && task->alignments() == 0 && task->faults == 0) {
+                    run.tasks.pop_back();
+                }
+                run.tasks.push_back(TaskLog());
+                run.tasks.back().name = name;
+                if (last.time >= 0) {
+                    run.tasks.back().samples.push_back(last);
+                }
+            }
+        } else if (starts_with(line, "# task done:")) {
+            // the next task's name isn't known until its "# task:" line
+            run.tasks.push_back(TaskLog());
+            if (last.time >= 0) {
+                run.tasks.back().samples.push_back(last);
+            }
+        } else if (starts_with(line, "# current x:")) {
+            task->xChecks++;
+        } else if (starts_with(line, "# current y:")) {
+            task->yChecks++;
+        } else if (starts_with(line, "# current h:")) {
+            task->headingChecks++;
+        } else if (starts_with(line, "using big pulse")) {
+            task->bigPulses++;
+        } else if (starts_with(line, "using short pulse")) {
+            task->shortPulses++;
+        } else if (starts_with(line, "using tiny pulse")) {
+            task->tinyPulses++;
+        } else if (starts_with(line, "# fault:")) {
+            task->faults++;
+        } else if (starts_with(line, "# governor:")) {
+            const char *late = std::strstr(line, "late ");
+            if (late && std::atof(late + 5) > 0) {
+                task->lateDecisions++;
+            }
+        }
+    }
+    std::fclose(file);
+    if (run.tasks.back().name.empty()) {
+        if (run.tasks.back().alignments() == 0 && run.tasks.back().faults == 0) {
+            run.tasks.pop_back();
+        } else {
+            run.tasks.back().name = "after course";
+        }
+    }
+    return run;
+}
+
+// position at fraction `t` (0 to 1) of the way through the task's samples, skipping ones where RPS failed
+static bool position_at(const std::vector<Sample> &samples, double t, double *x, double *y) {
+    std::vector<const Sample *> valid;
+    for (const Sample &sample : samples) {
+        if (sample.x >= 0 && sample.y >= 0) {
+            valid.push_back(&sample);
+        }
+    }
+    if (valid.empty()) {
+        return false;
+    }
+    double index = t * (valid.size() - 1);
+    int i = (int)index;
+    if (i + 1 >= (int)valid.size()) {
+        *x = valid.back()->x;
+        *y = valid.back()->y;
+        return true;
+    }
+    double f = index - i;
+    *x = valid[i]->x + f * (valid[i + 1]->x - valid[i]->x);
+    *y = valid[i]->y + f * (valid[i + 1]->y - valid[i]->y);
+    return true;
+}
+
+// average distance between two paths through the same task, in inches, or -1 if either has no positions
+static double divergence(const TaskLog &task, const TaskLog &baseline) {
+    double total = 0;
+    for (int i = 0; i < TRAJECTORY_POINTS; i++) {
+        double t = (double)i / (TRAJECTORY_POINTS - 1);
+        double x, y, baseX, baseY;
+        if (!position_at(task.samples, t, &x, &y) || !position_at(baseline.samples, t, &baseX, &baseY)) {
+            return -1;
+        }
+        total += std::hypot(x - baseX, y - baseY);
+    }
+    return total / TRAJECTORY_POINTS;
+}
+
+static void write_dataset(const char *path, const std::vector<Run> &runs) {
+    FILE *file = std::fopen(path, "w");
+    if (!file) {
+        std::fprintf(stderr, "loganalyze: can't write %s\n", path);
+        std::exit(2);
+    }
+    std::fprintf(file, "run,task,time,samples,x_checks,y_checks,h_checks,big_pulses,short_pulses,tiny_pulses,faults,late_decisions\n");
+    for (const Run &run : runs) {
+        for (const TaskLog &task : run.tasks) {
+            std::fprintf(file, "%s,%s,%f,%d,%d,%d,%d,%d,%d,%d,%d,%d\n", run.path.c_str(), task.name.c_str(), task.time(),
+                         (int)task.samples.size(), task.xChecks, task.yChecks, task.headingChecks, task.bigPulses,
+                         task.shortPulses, task.tinyPulses, task.faults, task.lateDecisions);
+        }
+    }
+    std::fclose(file);
+}
+
+// the first sample of each task after the first is the last one before it started,
+// so it shows up under both tasks
+static void write_samples(const char *path, const std::vector<Run> &runs) {
+    FILE *file = std::fopen(path, "w");
+    if (!file) {
+        std::fprintf(stderr, "loganalyze: can't write %s\n", path);
+        std::exit(2);
+    }
+    std::fprintf(file, "run,task,time,x,y,heading,cds\n");
+    for (const Run &run : runs) {
+        for (const TaskLog &task : run.tasks) {
+            for (const Sample &sample : task.samples) {
+                std::fprintf(file, "%s,%s,%f,%f,%f,%f,%f\n", run.path.c_str(), task.name.c_str(), sample.time,
+                             sample.x, sample.y, sample.heading, sample.cds);
+            }
+        }
+    }
+    std::fclose(file);
+}
+
+int main(int argc, char **argv) {
+    const char *baselinePath = nullptr;
+    const char *datasetPath = nullptr;
+    const char *samplesPath = nullptr;
+    // how much slower, or how many more alignment iterations, than the baseline a task may take, as a fraction
+    double tolerance = 0.25;
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = std::atof(argv[++i]);
+        } else if (!std::strcmp(argv[i], "--dataset") && i + 1 < argc) {
+            datasetPath = argv[++i];
+        } else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc) {
+            samplesPath = argv[++i];
+        } else if (argv[i][0] == '-') {
+            std::fprintf(stderr, "usage: %s [--baseline RUN] [--tolerance FRACTION] [--dataset OUT.csv] [--samples OUT.csv] RUN...\n", argv[0]);
+            return 2;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) {
+        std::fprintf(stderr, "loganalyze: no runs given\n");
+        return 2;
+    }
+
+    std::vector<Run> runs;
+    for (const char *path : paths) {
+        runs.push_back(read_run(path));
+    }
+    Run baseline = baselinePath ? read_run(baselinePath) : runs.front();
+    if (datasetPath) {
+        write_dataset(datasetPath, runs);
+    }
+    if (samplesPath) {
+        write_samples(samplesPath, runs);
+    }
+
+    std::printf("baseline: %s\n", baseline.path.c_str());
+    bool regressed = false;
+    for (const Run &run : runs) {
+        std::printf("\n%s\n", run.path.c_str());
+        std::printf("  %-12s %8s %6s %6s %6s %14s %6s %6s %10s\n", "task", "time", "x", "y", "h", "big/short/tiny", "faults", "late", "divergence");
+        double total = 0;
+        for (const TaskLog &task : run.tasks) {
+            total += task.time();
+            const TaskLog *base = baseline.task(task.name);
+            double diverged = base ? divergence(task, *base) : -1;
+            char pulses[32];
+            std::snprintf(pulses, sizeof(pulses), "%d/%d/%d", task.bigPulses, task.shortPulses, task.tinyPulses);
+            char divergenceText[32] = "-";
+            if (diverged >= 0) {
+                std::snprintf(divergenceText, sizeof(divergenceText), "%.2f", diverged);
+            }
+            std::printf("  %-12s %8.2f %6d %6d %6d %14s %6d %6d %10s", task.name.c_str(), task.time(), task.xChecks,
+                        task.yChecks, task.headingChecks, pulses, task.faults, task.lateDecisions, divergenceText);
+            if (base && run.path != baseline.path) {
+                if (task.time() > base->time() * (1 + tolerance) + TIME_SLACK) {
+                    std::printf("  SLOWER (%.2f s)", base->time());
+                    regressed = true;
+                }
+                if (task.alignments() > base->alignments() * (1 + tolerance) + ALIGNMENT_SLACK) {
+                    std::printf("  MORE ALIGNMENT (%d)", base->alignments());
+                    regressed = true;
+                }
+                if (task.faults > base->faults) {
+                    std::printf("  MORE FAULTS (%d)", base->faults);
+                    regressed = true;
+                }
+                if (diverged > DIVERGENCE_LIMIT) {
+                    std::printf("  DIVERGED");
+                    regressed = true;
+                }
+            } else if (!base) {
+                std::printf("  (not in baseline)");
+            }
+            std::printf("\n");
+        }
+        std::printf("  %-12s %8.2f\n", "total", total);
+    }
+
+    if (regressed) {
+        std::printf("\nregression against %s\n", baseline.path.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Unit types for motion commands and the robot geometry used to convert between them.
+//
+// Distances, turn angles, encoder counts and motor percents each get their own type
+// so they can't be mixed up. The _in, _deg and _pct literals are checked when the
+// code is compiled (see bench/units_errors.cpp). A route distance that's worked out
+// from several literals goes through route_counts into a constexpr Counts, which
+// makes the compiler work out its encoder target and check it. Everything here
+// compiles down to the plain numbers it wraps.
+#ifndef UNITS_H
+#define UNITS_H
+
+// radius of wheel, in inches
+constexpr double WHEEL_RADIUS = 2.5 / 2;
+
+// wheel distance, in inches
+constexpr double WHEEL_DISTANCE = 7;
+
+// the ratio of a circles circumphrence to its diameter
+constexpr double PI = 3.14159;
+
+// how many counts in one revoltion of an Igwan motor
+constexpr int ONE_REVOLUTION_COUNTS = 318;
+
+// a floating point amount of some unit. `Tag` only keeps the units apart
+template <typename Tag>
+struct Quantity {
+    double value;
+
+    constexpr explicit Quantity(double value) : value(value) {}
+
+    constexpr Quantity operator-() const { return Quantity(-value); }
+    constexpr Quantity operator+(Quantity other) const { return Quantity(value + other.value); }
+    constexpr Quantity operator-(Quantity other) const { return Quantity(value - other.value); }
+    constexpr Quantity operator*(double factor) const { return Quantity(value * factor); }
+    constexpr Quantity operator/(double divisor) const { return Quantity(value / divisor); }
+    constexpr bool operator<(Quantity other) const { return value < other.value; }
+    constexpr bool operator>(Quantity other) const { return value > other.value; }
+};
+
+// a distance driven, in inches
+typedef Quantity<struct InchesTag> Inches;
+
+// an angle turned in place, in degrees
+typedef Quantity<struct DegreesTag> Degrees;
+
+// a number of encoder counts
+struct Counts {
+    int value;
+
+    constexpr explicit Counts(int value) : value(value) {}
+
+    constexpr bool operator<(Counts other) const { return value < other.value; }
+    constexpr bool operator>=(Counts other) const { return value >= other.value; }
+};
+
+// called when a motor percent is outside [-100, 100]
+// it isn't constexpr, so a constexpr Percent that's out of range won't compile
+// (_pct literals are checked separately, below). at run time it clamps instead
+inline double percent_out_of_range(double percent) {
+    return percent > 100 ? 100 : -100;
+}
+
+// a motor power, in percent. negative is backward
+struct Percent {
+    double value;
+
+    constexpr explicit Percent(double value)
+        : value(value >= -100 && value <= 100 ? value : percent_out_of_range(value)) {}
+
+    constexpr Percent operator-() const { return Percent(-value); }
+    constexpr Percent operator*(double factor) const { return Percent(value * factor); }
+    constexpr bool operator>(Percent other) const { return value > other.value; }
+    constexpr bool operator<(Percent other) const { return value < other.value; }
+};
+
+// encoder counts per inch the wheels roll
+constexpr double COUNTS_PER_INCH = ONE_REVOLUTION_COUNTS / (2 * PI * WHEEL_RADIUS);
+
+// inches each wheel rolls per degree the robot turns in place
+constexpr double INCHES_PER_DEGREE = (WHEEL_DISTANCE / 2) * PI / 180;
+
+// round to the nearest count (instead of truncating, which always comes up short)
+constexpr int round_counts(double counts) {
+    return counts < 0 ? -round_counts(-counts) : (int)(counts + 0.5);
+}
+
+// encoder counts to roll `inches` inches
+constexpr Counts to_counts(Inches inches) {
+    return Counts(round_counts(inches.value * COUNTS_PER_INCH));
+}
+
+// encoder counts to turn `degrees` degrees in place
+constexpr Counts to_counts(Degrees degrees) {
+    return to_counts(Inches(degrees.value * INCHES_PER_DEGREE));
+}
+
+// called when a route distance comes to no encoder counts (or a negative number of them)
+// it isn't constexpr, so a constexpr route_counts(...) like that won't compile
+inline int route_too_short(int counts) {
+    return counts;
+}
+
+// encoder counts for a route distance made of several literals, like 18_in - 4_in.
+// assign it to a constexpr Counts so the sum is worked out and checked at compile time
+constexpr Counts route_counts(Inches inches) {
+    return Counts(to_counts(inches).value > 0 ? to_counts(inches).value : route_too_short(to_counts(inches).value));
+}
+
+// encoder counts for a route turn made of several literals, like 90_deg * 1.65
+constexpr Counts route_counts(Degrees degrees) {
+    return Counts(to_counts(degrees).value > 0 ? to_counts(degrees).value : route_too_short(to_counts(degrees).value));
+}
+
+// inches rolled for `counts` encoder counts
+constexpr Inches to_inches(Counts counts) {
+    return Inches(counts.value / COUNTS_PER_INCH);
+}
+
+constexpr bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// true if `text` is only digits with at most one '.'
+constexpr bool is_plain_decimal(const char *text, bool seenPoint = false) {
+    return *text == '\0' ? true
+         : is_digit(*text) ? is_plain_decimal(text + 1, seenPoint)
+         : *text == '.' && !seenPoint ? is_plain_decimal(text + 1, true)
+         : false;
+}
+
+// value of the digits after the decimal point in `text`, where the first one is worth `place`
+constexpr double parse_fraction(const char *text, double place) {
+    return is_digit(*text) ? (*text - '0') * place + parse_fraction(text + 1, place / 10) : 0;
+}
+
+// value of a plain decimal number like "12.31" or ".5"
+constexpr double parse_decimal(const char *text, double whole = 0) {
+    return is_digit(*text) ? parse_decimal(text + 1, whole * 10 + (*text - '0'))
+         : *text == '.' ? whole + parse_fraction(text + 1, 0.1)
+         : whole;
+}
+
+// the characters of a numeric literal, handed to a literal operator template by the compiler.
+// `value` is a static constexpr member, so the compiler has to work it out
+template <char... Chars>
+struct Literal {
+    static constexpr char text[sizeof...(Chars) + 1] = {Chars..., '\0'};
+    static constexpr bool plain = is_plain_decimal(text);
+    static constexpr double value = parse_decimal(text);
+};
+
+template <char... Chars>
+constexpr char Literal<Chars...>::text[sizeof...(Chars) + 1];
+
+// Route literals. They're templates so each one is parsed and checked when the code
+// is compiled, even when the literal is passed straight to a function like move_forward(80_pct, 8.25_in)
+
+template <char... Chars>
+constexpr Inches operator"" _in() {
+    static_assert(Literal<Chars...>::plain, "_in literals should be plain decimals like 12.31");
+    static_assert(Literal<Chars...>::value == 0 || to_counts(Inches(Literal<Chars...>::value)).value > 0,
+                  "distance is too short for the encoders to count");
+    return Inches(Literal<Chars...>::value);
+}
+
+template <char... Chars>
+constexpr Degrees operator"" _deg() {
+    static_assert(Literal<Chars...>::plain, "_deg literals should be plain decimals like 22.5");
+    static_assert(Literal<Chars...>::value == 0 || to_counts(Degrees(Literal<Chars...>::value)).value > 0,
+                  "turn is too small for the encoders to count");
+    return Degrees(Literal<Chars...>::value);
+}
+
+template <char... Chars>
+constexpr Percent operator"" _pct() {
+    static_assert(Literal<Chars...>::plain, "_pct literals should be plain decimals like 55");
+    static_assert(Literal<Chars...>::value <= 100, "motor percent can't be more than 100");
+    return Percent(Literal<Chars...>::value);
+}
+
+static_assert(to_counts(Inches(2 * PI * WHEEL_RADIUS)).value == ONE_REVOLUTION_COUNTS,
+              "one wheel circumference should be one revolution of counts");
+static_assert(to_counts(360_deg).value == round_counts(ONE_REVOLUTION_COUNTS * WHEEL_DISTANCE / (2 * WHEEL_RADIUS)),
+              "a full turn should roll each wheel around the circle between the wheels");
+static_assert(to_counts(1_deg).value >= 1, "encoders can't resolve a one degree turn");
+static_assert(to_counts(-2.5_in).value == -to_counts(2.5_in).value, "rounding should be symmetric");
+
+#endif